@@ -99,10 +99,15 @@ struct Stats
    umax count = 0;
    umax size = 0;
    umax ondisk = 0;
+   umax sampled = 0;
+   umax compressed = 0;
 
    void Add(umax bytes, umax disk) { count++; size+=bytes; ondisk+=disk; }
+   void Add(const Stats& o) { count+=o.count; size+=o.size; ondisk+=o.ondisk; sampled+=o.sampled; compressed+=o.compressed; }
 
    umax Avg() const { return (umax)round(size / (double)count); }
+   double Ratio() const { return compressed / (double)sampled; }
+   umax EstCompressed() const { return (umax)round(size * Ratio()); }
 };
 
 struct FileStats
@@ -127,6 +132,149 @@ struct FileInfo
    umax ondisk = 0;
 };
 
+// Keeps the largest N files seen so far as a min-heap, so the top list can be shown while scanning
+struct TopFiles
+{
+   size_t capacity = 0;
+   vector<FileInfo> heap;
+
+   static bool Greater(const FileInfo& a, const FileInfo& b) { return a.size > b.size; }
+
+   void Add(const FileInfo& info)
+   {
+      if (capacity == 0)
+         return;
+
+      if (heap.size() < capacity)
+      {
+         heap.push_back(info);
+         push_heap(heap.begin(), heap.end(), Greater);
+      }
+      else if (info.size > heap.front().size)
+      {
+         pop_heap(heap.begin(), heap.end(), Greater);
+         heap.back() = info;
+         push_heap(heap.begin(), heap.end(), Greater);
+      }
+   }
+
+   // Only the rows asked for are copied, the live panel calls this while the workers wait on it
+   vector<FileInfo> Sorted(size_t count=SIZE_MAX) const
+   {
+      vector<FileInfo> ret(min(count, heap.size()));
+      partial_sort_copy(heap.begin(), heap.end(), ret.begin(), ret.end(), Greater);
+      return ret;
+   }
+};
+
+// A directory waiting to be scanned by the largest-first scheduler.  The hint is the number of bytes
+// we expect to find beneath it, estimated from its parent, and the queue always pops the biggest hint.
+struct DirTask
+{
+   path dir;
+   int depth = 0;
+   umax hint = 0;
+
+   bool operator<(const DirTask& o) const { return hint < o.hint; }
+};
+
+// Splits what is left of the parent's expected size evenly among its subdirectories.  A parent whose own
+// files were large or numerous makes its children look promising too.  Roots are queued with unknown_hint
+// so they're scanned first, and their children are judged by the root's own files alone.
+constexpr umax unknown_hint = UINTMAX_MAX;
+
+umax ChildHint(umax parenthint, umax filebytes, umax entries, umax avgfile, size_t subdirs)
+{
+   umax remaining = parenthint != unknown_hint && parenthint > filebytes ? parenthint - filebytes : filebytes;
+   return (remaining + entries * avgfile) / max<size_t>(subdirs, 1);
+}
+
+constexpr size_t max_scan_workers = 64;
+
+// Hill-climbs the number of active scan workers toward the highest entries/sec.  Samples are smoothed
+// with an EWMA that restarts after every change and is only judged once it has settled, since one
+// directory's worth of work is far noisier than the tolerances below.  The controller remembers the best
+// rate seen.  It keeps stepping while the rate beats that by a clear margin, and on a plateau it tries
+// fewer workers, keeping each step down only while the rate stays within tolerance of the best.  A step
+// that falls short goes back to the last accepted count and holds there.  After the hold it probes
+// again, upward unless size_on_disk latency has climbed since the best rate.  If the accepted count
+// itself has fallen short by then, the workload has changed and the best rate is measured again.
+struct ConcurrencyController
+{
+   static constexpr double smoothing = 0.2;
+   static constexpr double gain = 1.03;        // A step must beat the best rate by this much to count as a gain
+   static constexpr double tolerance = 0.95;   // Fewer workers are kept while the rate stays above best*this
+   static constexpr int settle = 6;            // Intervals to let the EWMA fill after a change
+   static constexpr int hold = 8;              // Intervals to stay put after backing out of a step
+
+   size_t active = 1;
+   size_t limit = 1;
+   bool adaptive = true;
+   size_t accepted = 0;
+   int step = 1;
+   int wait = 0;
+   bool returned = false;
+   double rate = 0;
+   double latency = 0;
+   double best = 0;
+   double bestlatency = 0;
+
+   void Move(int dir)
+   {
+      step = dir;
+      const imax size = max<imax>(1, (imax)active / 4);
+      active = (size_t)clamp<imax>((imax)active + dir * size, 1, (imax)limit);
+      rate = 0;
+      latency = 0;
+      wait = settle;
+   }
+
+   void Update(double sample, double samplelatency)
+   {
+      if (!adaptive)
+         return;
+
+      rate = rate > 0 ? rate + smoothing * (sample - rate) : sample;
+      latency = latency > 0 ? latency + smoothing * (samplelatency - latency) : samplelatency;
+      if (wait > 0)
+      {
+         wait--;
+         return;
+      }
+
+      if (returned)
+      {
+         returned = false;
+         if (rate < best * tolerance)
+         {
+            best = rate;
+            bestlatency = latency;
+         }
+         Move(bestlatency > 0 && latency > bestlatency * 1.5 ? -1 : 1);
+      }
+      else if (rate > best * gain)
+      {
+         best = rate;
+         bestlatency = latency;
+         accepted = active;
+         Move(step);
+      }
+      else if (rate >= best * tolerance)
+      {
+         accepted = active;
+         Move(-1);
+      }
+      else
+      {
+         active = accepted;
+         returned = true;
+         rate = 0;
+         latency = 0;
+         wait = hold;
+      }
+   }
+};
+
 HANDLE console = nullptr;
 
 void SetColor(int color) { SetConsoleTextAttribute(console, color); }
@@ -159,13 +307,29 @@ void Clear()
    SetConsoleCursorPosition(console, screen.dwCursorPosition);
 }
 
+void ClearRows(short y, short count)
+{
+   COORD start = {0, y};
+   DWORD written;
+   auto width = GetSize().X;
+   FillConsoleOutputCharacterA(console, ' ', width * count, start, &written);
+   FillConsoleOutputAttribute(console, FOREGROUND_GREEN | FOREGROUND_RED | FOREGROUND_BLUE, width * count, start, &written);
+}
+
+short GetWindowRows()
+{
+   CONSOLE_SCREEN_BUFFER_INFO screen;
+   GetConsoleScreenBufferInfo(console, &screen);
+   return screen.srWindow.Bottom - screen.srWindow.Top + 1;
+}
+
 void Write(COORD pos, cstr s)
 {
    SetPos(pos);
    DWORD written;
    auto width = GetSize().X;
-   auto ss = sformat("%*s\n", width, s);
-   WriteConsoleA(console, s, width, &written, nullptr);
+   auto ss = sformat("%-*s", width, s);
+   WriteConsoleA(console, ss, width, &written, nullptr);
 }
 
 cstr BytesStr(umax bytes)
@@ -212,14 +376,838 @@ size_t size_on_disk(cstr filename)
       return low;
 }
 
+size_t WorkerCount() { return max(1u, thread::hardware_concurrency()); }
+
+// Hands out [begin, end) batches of count items to one thread per core.  func also gets the index of
+// the worker running it, so callers can keep per-worker results and merge them afterwards.
+TCT void ParallelFor(size_t count, size_t batch, T&& func)
+{
+   atomic<size_t> next = 0;
+   vector<thread> workers;
+   loopi(WorkerCount())
+   {
+      workers.emplace_back([&, i]
+      {
+         for (size_t begin; (begin = next.fetch_add(batch)) < count;)
+            func(begin, min(begin + batch, count), (size_t)i);
+      });
+   }
+   for (auto& w: workers)
+      w.join();
+}
+
+// Positional read of up to size bytes, returns how many were read or 0 if the file couldn't be opened
+size_t ReadBlock(const path& file, umax offset, void* buf, size_t size)
+{
+   HANDLE h = CreateFileW(file.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                          nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+   if (h == INVALID_HANDLE_VALUE)
+      return 0;
+
+   OVERLAPPED at {};
+   at.Offset = (DWORD)offset;
+   at.OffsetHigh = (DWORD)(offset >> 32);
+
+   DWORD read = 0;
+   if (!ReadFile(h, buf, (DWORD)size, &read, &at))
+      read = 0;
+   CloseHandle(h);
+   return read;
+}
+
+struct Signature
+{
+   size_t offset;
+   sview magic;
+   wcstr type;
+};
+
+static const Signature signatures[]
+{
+   {0,   "\x89PNG\r\n\x1A\n"sv,                 L"png image"},
+   {0,   "\xFF\xD8\xFF"sv,                      L"jpeg image"},
+   {0,   "GIF87a"sv,                            L"gif image"},
+   {0,   "GIF89a"sv,                            L"gif image"},
+   {0,   "II*\0"sv,                             L"tiff image"},
+   {0,   "MM\0*"sv,                             L"tiff image"},
+   {0,   "8BPS"sv,                              L"photoshop image"},
+   {0,   "%PDF-"sv,                             L"pdf document"},
+   {0,   "\xD0\xCF\x11\xE0\xA1\xB1\x1A\xE1"sv,  L"ole compound file"},
+   {0,   "PK\x03\x04"sv,                        L"zip archive"},
+   {0,   "PK\x05\x06"sv,                        L"zip archive"},
+   {0,   "7z\xBC\xAF\x27\x1C"sv,                L"7z archive"},
+   {0,   "Rar!\x1A\x07"sv,                      L"rar archive"},
+   {0,   "\x1F\x8B"sv,                          L"gzip stream"},
+   {0,   "BZh"sv,                               L"bzip2 stream"},
+   {0,   "\xFD" "7zXZ\0"sv,                     L"xz stream"},
+   {0,   "\x28\xB5\x2F\xFD"sv,                  L"zstd stream"},
+   {0,   "MSCF"sv,                              L"cab archive"},
+   {0,   "MZ"sv,                                L"pe executable"},
+   {0,   "\x7F" "ELF"sv,                        L"elf executable"},
+   {0,   "\xCA\xFE\xBA\xBE"sv,                  L"java class"},
+   {0,   "\0asm"sv,                             L"wasm module"},
+   {0,   "SQLite format 3\0"sv,                 L"sqlite database"},
+   {0,   "!BDN"sv,                              L"outlook pst"},
+   {0,   "ElfFile\0"sv,                         L"event log"},
+   {0,   "MDMP"sv,                              L"minidump"},
+   {0,   "vhdxfile"sv,                          L"vhdx disk image"},
+   {0,   "conectix"sv,                          L"vhd disk image"},
+   {0,   "KDMV"sv,                              L"vmdk disk image"},
+   {0,   "RIFF"sv,                              L"riff media"},
+   {0,   "ID3"sv,                               L"mp3 audio"},
+   {0,   "OggS"sv,                              L"ogg media"},
+   {0,   "fLaC"sv,                              L"flac audio"},
+   {0,   "\x1A\x45\xDF\xA3"sv,                  L"matroska media"},
+   {4,   "ftyp"sv,                              L"mp4 media"},
+   {257, "ustar"sv,                             L"tar archive"},
+   {0,   "\xEF\xBB\xBF"sv,                      L"text"},
+   {0,   "\xFF\xFE"sv,                          L"utf-16 text"},
+   {0,   "<?xml"sv,                             L"xml"},
+};
+
+// All signatures compiled into one byte trie per offset, so a header is matched in a single pass per
+// offset no matter how many signatures there are.  The longest match wins.
+struct SignatureTrie
+{
+   struct Node
+   {
+      vector<pair<u8, u32>> edges;
+      wcstr type = nullptr;
+   };
+
+   vector<Node> nodes;
+   vector<pair<size_t, u32>> roots;
+
+   SignatureTrie(const Signature* begin, const Signature* end)
+   {
+      for (auto sig=begin; sig!=end; ++sig)
+         Insert(*sig);
+   }
+
+   u32 Child(u32 node, u8 c) const
+   {
+      for (const auto& [edge, child]: nodes[node].edges)
+         if (edge == c)
+            return child;
+      return 0;
+   }
+
+   void Insert(const Signature& sig)
+   {
+      auto root = find_if(roots.begin(), roots.end(), [&](const auto& r){ return r.first == sig.offset; });
+      u32 node;
+      if (root != roots.end())
+      {
+         node = root->second;
+      }
+      else
+      {
+         node = (u32)nodes.size();
+         nodes.emplace_back();
+         roots.emplace_back(sig.offset, node);
+      }
+
+      for (char c: sig.magic)
+      {
+         u32 next = Child(node, (u8)c);
+         if (!next)
+         {
+            next = (u32)nodes.size();
+            nodes.emplace_back();
+            nodes[node].edges.emplace_back((u8)c, next);
+         }
+         node = next;
+      }
+      nodes[node].type = sig.type;
+   }
+
+   wcstr Match(const u8* data, size_t len) const
+   {
+      wcstr best = nullptr;
+      size_t bestlen = 0;
+      for (const auto& [offset, root]: roots)
+      {
+         u32 node = root;
+         for (size_t i=offset; i<len && (node = Child(node, data[i])); i++)
+         {
+            if (nodes[node].type && i - offset + 1 > bestlen)
+            {
+               best = nodes[node].type;
+               bestlen = i - offset + 1;
+            }
+         }
+      }
+      return best;
+   }
+};
+
+constexpr size_t sniff_bytes = 4_KB;
+
+wcstr DetectType(const u8* data, size_t len)
+{
+   static const SignatureTrie trie(begin(signatures), end(signatures));
+
+   if (len == 0)
+      return L"(unreadable)";
+
+   if (auto type = trie.Match(data, len))
+      return type;
+
+   size_t printable = 0;
+   loopi(len)
+   {
+      if (data[i] == 0)
+         return L"(binary)";
+      if (data[i] >= 0x20 || data[i] == '\t' || data[i] == '\n' || data[i] == '\r')
+         printable++;
+   }
+   return printable * 100 >= len * 95 ? L"text" : L"(binary)";
+}
+
+// Reads the first few KB of every file and tallies them by detected type.  Files are read in path order
+// so each worker mostly walks one directory at a time.
+unordered_map<wstring, Stats> SniffTypes(vector<FileInfo>& files)
+{
+   sort(files.begin(), files.end(), [](const auto& a, const auto& b){ return a.path < b.path; });
+
+   vector<unordered_map<wstring, Stats>> results(WorkerCount());
+   ParallelFor(files.size(), 64, [&](size_t begin, size_t end, size_t worker)
+   {
+      u8 header[sniff_bytes];
+      for (size_t i=begin; i<end; i++)
+      {
+         const auto& f = files[i];
+         size_t len = ReadBlock(f.path, 0, header, sizeof header);
+         results[worker][DetectType(header, len)].Add(f.size, f.ondisk);
+      }
+   });
+
+   unordered_map<wstring, Stats> bytype;
+   for (const auto& r: results)
+      for (const auto& [type, s]: r)
+         bytype[type].Add(s);
+   return bytype;
+}
+
+// Greedy LZ77 pass in the style of LZ4 that only counts the bytes it would emit.  Not a real
+// compressor, but it tracks fast LZ-class codecs such as NTFS compression closely enough for planning.
+size_t EstimateCompressed(const u8* data, size_t len)
+{
+   constexpr size_t min_match = 4;
+   constexpr int hash_bits = 14;
+   static thread_local u32 table[1 << hash_bits];
+   memset(table, 0, sizeof table);
+
+   auto hash = [&](size_t i) { u32 v; memcpy(&v, data + i, 4); return (v * 2654435761u) >> (32 - hash_bits); };
+
+   size_t out = 0;
+   size_t literals = 0;
+   size_t i = 0;
+   while (i + min_match <= len)
+   {
+      auto h = hash(i);
+      size_t cand = table[h];
+      table[h] = (u32)i;
+
+      if (cand < i && i - cand <= 0xFFFF && memcmp(data + cand, data + i, min_match) == 0)
+      {
+         size_t match = min_match;
+         while (i + match < len && data[cand + match] == data[i + match])
+            match++;
+
+         // token + literal run + 16 bit offset + any extra length bytes
+         out += 1 + literals + literals / 255 + 2 + (match - min_match) / 255;
+         literals = 0;
+         i += match;
+      }
+      else
+      {
+         literals++;
+         i++;
+      }
+   }
+   literals += len - i;
+   out += 1 + literals + literals / 255;
+   return min(out, len);
+}
+
+struct SampleBlock
+{
+   path file;
+   umax offset;
+   size_t size;
+   size_t ext;
+};
+
+constexpr size_t sample_block = 64_KB;
+constexpr size_t max_ext_blocks = 32;
+
+// Samples blocks from each extension's files and stores the sampled and estimated compressed byte counts
+// in stats.byext.  Every extension reads at most budget of its own bytes, which bounds the whole run to
+// budget of the scanned data.  Returns the number of bytes actually read.
+umax EstimateCompressibility(FileStats& stats, const unordered_map<wstring, vector<FileInfo>>& filesByExt, double budget)
+{
+   vector<wstring> exts;
+   vector<SampleBlock> blocks;
+
+   for (const auto& [ext, files]: filesByExt)
+   {
+      const umax allowance = (umax)(stats.byext[ext].size * budget);
+      size_t count = (size_t)min<umax>(max_ext_blocks, allowance / sample_block);
+      size_t blocksize = sample_block;
+      if (count == 0 && allowance >= 4_KB)
+      {
+         count = 1;
+         blocksize = (size_t)allowance;
+      }
+      if (count == 0 || files.empty())
+         continue;
+
+      // Spread the blocks evenly over the extension's bytes rather than its files, so one huge file
+      // gets as many blocks as its share of the size.  Each block lands on the 4 KB aligned offset
+      // where its target byte falls.
+      const umax total = stats.byext[ext].size;
+      size_t file = 0;
+      umax filestart = 0;
+      loopi(count)
+      {
+         const umax target = (umax)((i + 0.5) * total / count);
+         while (file + 1 < files.size() && filestart + files[file].size <= target)
+            filestart += files[file++].size;
+
+         const auto& f = files[file];
+         if (f.size == 0)
+            continue;
+         umax span = f.size > blocksize ? f.size - blocksize : 0;
+         umax offset = min(target - min(target, filestart), span) & ~(umax)(4_KB - 1);
+         blocks.push_back({f.path, offset, blocksize, exts.size()});
+      }
+      exts.push_back(ext);
+   }
+
+   sort(blocks.begin(), blocks.end(), [](const auto& a, const auto& b){ return a.file < b.file; });
+
+   struct Sample { umax read = 0; umax compressed = 0; };
+   vector<vector<Sample>> results(WorkerCount(), vector<Sample>(exts.size()));
+   ParallelFor(blocks.size(), 4, [&](size_t begin, size_t end, size_t worker)
+   {
+      vector<u8> buf(sample_block);
+      for (size_t i=begin; i<end; i++)
+      {
+         const auto& b = blocks[i];
+         buf.resize(b.size);
+         size_t len = ReadBlock(b.file, b.offset, buf.data(), b.size);
+         auto& r = results[worker][b.ext];
+         r.read += len;
+         r.compressed += EstimateCompressed(buf.data(), len);
+      }
+   });
+
+   umax total = 0;
+   for (const auto& r: results)
+   {
+      loopi(exts.size())
+      {
+         auto& s = stats.byext[exts[i]];
+         s.sampled += r[i].read;
+         s.compressed += r[i].compressed;
+         total += r[i].read;
+      }
+   }
+   return total;
+}
+
+// Snapshots are a header followed by one record per file and directory, sorted by path, so two of them
+// can be diffed with a single streaming merge.  Directory records carry the totals of their subtree.
+constexpr char snapshot_magic[8] = {'F', 'T', 'S', 'N', 'A', 'P', '1', 0};
+
+enum : u8
+{
+   snap_file,
+   snap_dir,
+};
+
+constexpr u32 max_snap_path = 32767;   // Longest path Windows allows, in UTF-16 units
+
+struct SnapRecord
+{
+   u8 kind = snap_file;
+   umax size = 0;
+   umax ondisk = 0;
+   wstring path;
+
+   int Compare(const SnapRecord& o) const
+   {
+      int c = path.compare(o.path);
+      return c ? c : (int)kind - (int)o.kind;
+   }
+};
+
+FILE* OpenFile(const path& file, wcstr mode)
+{
+   FILE* f = nullptr;
+   if (_wfopen_s(&f, file.c_str(), mode) || !f)
+      throw gerror("can't open %ls", file.c_str());
+   setvbuf(f, nullptr, _IOFBF, 1_MB);
+   return f;
+}
+
+// Directory records stop at the scan roots, since anything above them would only hold the scanned part
+void SaveSnapshot(const path& file, const unordered_map<wstring, vector<FileInfo>>& filesByExt, const vector<string>& targets)
+{
+   vector<SnapRecord> records;
+   unordered_map<wstring, Stats> dirs;
+
+   vector<path> roots;
+   for (const auto& t: targets)
+   {
+      path root = path(t).lexically_normal();
+      roots.push_back(root.has_filename() || !root.has_relative_path() ? root : root.parent_path());
+   }
+   auto isroot = [&](const path& dir){ return find(roots.begin(), roots.end(), dir.lexically_normal()) != roots.end(); };
+
+   for (const auto& [ext, files]: filesByExt)
+   {
+      for (const auto& f: files)
+      {
+         records.push_back({snap_file, f.size, f.ondisk, f.path.wstring()});
+         for (auto dir=f.path.parent_path(); !dir.empty(); dir=dir.parent_path())
+         {
+            dirs[dir.wstring()].Add(f.size, f.ondisk);
+            if (isroot(dir) || !dir.has_relative_path())
+               break;
+         }
+      }
+   }
+
+   for (auto& [dir, s]: dirs)
+      records.push_back({snap_dir, s.size, s.ondisk, move(dir)});
+
+   sort(records.begin(), records.end(), [](const auto& a, const auto& b){ return a.Compare(b) < 0; });
+
+   FILE* f = OpenFile(file, L"wb");
+   const u64 count = records.size();
+   fwrite(snapshot_magic, sizeof snapshot_magic, 1, f);
+   fwrite(&count, sizeof count, 1, f);
+   for (const auto& r: records)
+   {
+      const u64 size = r.size;
+      const u64 ondisk = r.ondisk;
+      const u32 len = (u32)r.path.size();
+      fwrite(&r.kind, sizeof r.kind, 1, f);
+      fwrite(&size, sizeof size, 1, f);
+      fwrite(&ondisk, sizeof ondisk, 1, f);
+      fwrite(&len, sizeof len, 1, f);
+      fwrite(r.path.data(), sizeof(wchar), len, f);
+   }
+
+   bool failed = ferror(f);
+   fclose(f);
+   if (failed)
+      throw gerror("failed writing %ls", file.c_str());
+}
+
+// Streams records out of a snapshot one at a time, reusing the same record
+struct SnapshotReader
+{
+   FILE* f = nullptr;
+   u64 left = 0;
+   SnapRecord rec;
+
+   SnapshotReader(const path& file)
+   {
+      f = OpenFile(file, L"rb");
+      char magic[sizeof snapshot_magic];
+      if (fread(magic, sizeof magic, 1, f) != 1 || memcmp(magic, snapshot_magic, sizeof magic) != 0 ||
+          fread(&left, sizeof left, 1, f) != 1)
+      {
+         fclose(f);
+         throw gerror("%ls is not a snapshot", file.c_str());
+      }
+   }
+
+   ~SnapshotReader() { fclose(f); }
+
+   bool Next()
+   {
+      if (left == 0)
+         return false;
+
+      u64 size, ondisk;
+      u32 len;
+      bool ok = fread(&rec.kind, sizeof rec.kind, 1, f) == 1 &&
+                fread(&size, sizeof size, 1, f) == 1 &&
+                fread(&ondisk, sizeof ondisk, 1, f) == 1 &&
+                fread(&len, sizeof len, 1, f) == 1;
+      if (ok && (rec.kind > snap_dir || len > max_snap_path))
+         throw gerror("snapshot is corrupt");
+      if (ok)
+      {
+         rec.path.resize(len);
+         ok = fread(rec.path.data(), sizeof(wchar), len, f) == len;
+      }
+      if (!ok)
+         throw gerror("snapshot is truncated");
+
+      rec.size = size;
+      rec.ondisk = ondisk;
+      left--;
+      return true;
+   }
+};
+
+// Subtree sizes from a previous snapshot, used by the largest-first scheduler instead of guessing
+unordered_map<wstring, umax> LoadDirHints(const path& file)
+{
+   unordered_map<wstring, umax> hints;
+   SnapshotReader reader(file);
+   while (reader.Next())
+      if (reader.rec.kind == snap_dir)
+         hints[reader.rec.path] = reader.rec.size;
+   return hints;
+}
+
+struct SizePair
+{
+   cstr header[2];
+   umax(*func)(const Stats&);
+};
+
+static constexpr cstr prefmt = "  %-26ls %8s";
+static constexpr cstr numfmt[] {" %18s", " %16s"};
+static constexpr cstr ratiofmt = " %8s";
+
+const SizePair size_pairs[]
+{
+   {{"bytes",         "size"},         [](const Stats& s){ return s.size; }},
+   {{"avg bytes",     "avg size"},     [](const Stats& s){ return s.Avg(); }},
+   {{"bytes on disk", "size on disk"}, [](const Stats& s){ return s.ondisk; }},
+};
+
+// Extra columns for the extension table when -compressibility sampled it
+const SizePair compressed_pair {{"est. compressed", "est. comp size"}, [](const Stats& s){ return s.EstCompressed(); }};
+
+string TableHeader(wcstr key, bool compression=false)
+{
+   string header;
+   header += sformat(prefmt, key, "count");
+   for (const auto& s: size_pairs)
+      loopi(2)
+         header += sformat(numfmt[i], s.header[i]);
+   if (compression)
+   {
+      loopi(2)
+         header += sformat(numfmt[i], compressed_pair.header[i]);
+      header += sformat(ratiofmt, "ratio");
+   }
+   return header;
+}
+
+void PrintSizePair(umax sz)
+{
+   auto [bytes, size] = GetSizeStr(sz);
+   SetColor(gray);
+   printf(numfmt[0], bytes);
+   SetColor(GetSizeColor(sz));
+   printf(numfmt[1], size);
+}
+
+void PrintTableRow(const wstring& key, const Stats& stats, bool compression=false)
+{
+   SetColor(white);
+   printf(prefmt, key.c_str(), str(stats.count));
+   for (const auto& p: size_pairs)
+      PrintSizePair(p.func(stats));
+
+   if (compression && stats.sampled)
+   {
+      PrintSizePair(compressed_pair.func(stats));
+      SetColor(white);
+      printf(ratiofmt, sformat("%.2f", stats.Ratio()));
+   }
+   else if (compression)
+   {
+      SetColor(gray);
+      printf(numfmt[0], "-");
+      printf(numfmt[1], "-");
+      printf(ratiofmt, "-");
+   }
+   printf("\n");
+}
+
+vector<pair<wstring, Stats>> SortBySize(const unordered_map<wstring, Stats>& table, size_t count=SIZE_MAX)
+{
+   vector<pair<wstring, Stats>> rows(min(count, table.size()));
+   partial_sort_copy(table.begin(), table.end(), rows.begin(), rows.end(), [](const auto& a, const auto& b){ return a.second.size > b.second.size; });
+   return rows;
+}
+
+constexpr size_t top_file_prefix = 40;   // Width of the two size columns PrintTopFile puts before the path
+
+// Paths longer than maxpath keep their tail, since the file name matters more than the drive
+void PrintTopFile(const FileInfo& f, size_t maxpath=SIZE_MAX)
+{
+   SetColor(gray);
+   printf("  %16s", BytesStr(f.size));
+   SetColor(GetSizeColor(f.size));
+   printf(" %16s     ", SizeStr(f.size));
+   SetColor(white);
+
+   const auto name = f.path.wstring();
+   if (name.size() > maxpath && maxpath > 3)
+      printf("...%ls\n", name.c_str() + name.size() - (maxpath - 3));
+   else
+      printf("%ls\n", name.c_str());
+}
+
+// What the live panel shows, copied out of the scan state so the scan isn't blocked while it's drawn
+struct LiveView
+{
+   path current;
+   Stats total;
+   vector<FileInfo> top;
+   vector<pair<wstring, Stats>> exts;
+   umax errorcount;
+   string lasterror;
+
+   static size_t PanelRows() { return max<short>(GetWindowRows() - 4, 14); }
+   static size_t ListRows() { return (PanelRows() - 11) / 2; }
+
+   LiveView(const path& current, const FileStats& stats, const TopFiles& top, size_t listrows, umax errorcount, const string& lasterror):
+      current(current), total(stats.total), top(top.Sorted(listrows)), exts(SortBySize(stats.byext, listrows)),
+      errorcount(errorcount), lasterror(lasterror) {}
+};
+
+// Redraws the status lines plus the current top files and extensions below basey, sized to fit the window
+void DrawLive(short basey, const LiveView& view, size_t listrows, cstr status)
+{
+   ClearRows(basey, (short)LiveView::PanelRows());
+
+   auto y = basey;
+   SetColor(white);
+   Write({0, y++}, sformat("file: %s", view.current.string().c_str()));
+   Write({0, y++}, sformat("count: %s", str(view.total.count)));
+   Write({0, y++}, sformat("logical size: %s (%s)", SizeStr(view.total.size), BytesStr(view.total.size)));
+   SetColor(cyan);
+   Write({0, y++}, sformat("size on disk: %s (%s)", SizeStr(view.total.ondisk), BytesStr(view.total.ondisk)));
+   SetColor(gray);
+   Write({0, y++}, status);
+   SetColor(view.errorcount ? red : gray);
+   Write({0, y++}, view.errorcount ? sformat("errors: %s, last: %s", str(view.errorcount), view.lasterror.c_str()) : "errors: 0");
+
+   SetPos(0, y + 1);
+   SetColor(white);
+   printf("Top %s files so far:\n", str(listrows));
+   // Keep each path on one row, wrapped fragments would land in the extension table below
+   const size_t width = GetSize().X;
+   const size_t maxpath = width > top_file_prefix + 1 ? width - top_file_prefix - 1 : 0;
+   for (const auto& f: view.top)
+      PrintTopFile(f, maxpath);
+
+   SetPos(0, y + 3 + (short)listrows);
+   SetColor(white);
+   printf("%s\n", TableHeader(L"ext").c_str());
+   for (const auto& [ext, s]: view.exts)
+      PrintTableRow(ext, s);
+}
+
+// Keeps the N biggest changes by absolute byte delta, the same way TopFiles does for sizes
+struct TopDeltas
+{
+   size_t capacity = 0;
+   vector<pair<s64, wstring>> heap;
+
+   static bool Greater(const pair<s64, wstring>& a, const pair<s64, wstring>& b) { return llabs(a.first) > llabs(b.first); }
+
+   void Add(s64 delta, const wstring& path)
+   {
+      if (capacity == 0 || delta == 0)
+         return;
+
+      if (heap.size() < capacity)
+      {
+         heap.emplace_back(delta, path);
+         push_heap(heap.begin(), heap.end(), Greater);
+      }
+      else if (llabs(delta) > llabs(heap.front().first))
+      {
+         pop_heap(heap.begin(), heap.end(), Greater);
+         heap.back() = {delta, path};
+         push_heap(heap.begin(), heap.end(), Greater);
+      }
+   }
+
+   vector<pair<s64, wstring>> Sorted() const
+   {
+      vector<pair<s64, wstring>> ret(heap);
+      sort(ret.begin(), ret.end(), [](const auto& a, const auto& b){ return a.first > b.first; });
+      return ret;
+   }
+};
+
+struct DiffCounts
+{
+   umax added = 0;
+   umax removed = 0;
+   umax grown = 0;
+   umax shrunk = 0;
+   s64 delta = 0;
+};
+
+cstr DeltaStr(s64 delta)
+{
+   return sformat("%c%s", delta < 0 ? '-' : '+', SizeStr((umax)llabs(delta)));
+}
+
+void PrintDelta(s64 delta, const wstring& name)
+{
+   SetColor(delta > 0 ? red : green);
+   printf("  %18s     ", DeltaStr(delta));
+   SetColor(white);
+   printf("%ls\n", name.c_str());
+}
+
+// Merges two snapshots in one pass.  Memory only grows with the number of extensions and the top N lists,
+// never with the size of the snapshots.
+void RunDiff(const path& oldfile, const path& newfile, size_t topcount)
+{
+   SnapshotReader a(oldfile), b(newfile);
+   DiffCounts counts[2];
+   TopDeltas tops[2] {{topcount}, {topcount}};
+   unordered_map<wstring, pair<s64, s64>> byext;
+
+   auto change = [&](u8 kind, const wstring& name, umax before, umax after, int added)
+   {
+      const s64 delta = (s64)after - (s64)before;
+      auto& c = counts[kind];
+      c.delta += delta;
+      if (added > 0) c.added++;
+      else if (added < 0) c.removed++;
+      else if (delta > 0) c.grown++;
+      else if (delta < 0) c.shrunk++;
+
+      tops[kind].Add(delta, name);
+
+      if (kind == snap_file && (delta || added))
+      {
+         auto& e = byext[path(name).extension().wstring()];
+         e.first += delta;
+         e.second += added;
+      }
+   };
+
+   bool hasa = a.Next(), hasb = b.Next();
+   while (hasa || hasb)
+   {
+      int c = !hasa ? 1 : !hasb ? -1 : a.rec.Compare(b.rec);
+      if (c < 0)
+      {
+         change(a.rec.kind, a.rec.path, a.rec.size, 0, -1);
+         hasa = a.Next();
+      }
+      else if (c > 0)
+      {
+         change(b.rec.kind, b.rec.path, 0, b.rec.size, 1);
+         hasb = b.Next();
+      }
+      else
+      {
+         change(a.rec.kind, a.rec.path, a.rec.size, b.rec.size, 0);
+         hasa = a.Next();
+         hasb = b.Next();
+      }
+   }
+
+   static const cstr kinds[] {"files", "directories"};
+   printf("\n");
+   loopi(2)
+   {
+      const auto& c = counts[i];
+      SetColor(white);
+      printf("%s: %s added, %s removed, %s grown, %s shrunk, ", kinds[i], str(c.added), str(c.removed), str(c.grown), str(c.shrunk));
+      SetColor(c.delta > 0 ? red : green);
+      printf("%s\n", DeltaStr(c.delta));
+   }
+
+   vector<pair<wstring, pair<s64, s64>>> exts(byext.begin(), byext.end());
+   sort(exts.begin(), exts.end(), [](const auto& a, const auto& b){ return a.second.first > b.second.first; });
+
+   const string line(80, '-');
+   printf("\n\n");
+   SetColor(white);
+   printf("  %-26ls %8s %18s\n", L"ext", "count", "delta");
+   SetColor(gray);
+   printf("%s\n", line.c_str());
+   for (const auto& [ext, d]: exts)
+   {
+      SetColor(white);
+      printf("  %-26ls %8s", ext.c_str(), sformat("%+lld", (llong)d.second));
+      SetColor(d.first > 0 ? red : green);
+      printf(" %18s\n", DeltaStr(d.first));
+   }
+
+   rloopi(2)
+   {
+      printf("\n\n");
+      SetColor(white);
+      printf("Top %s changed %s:\n", str(topcount), kinds[i]);
+      SetColor(gray);
+      printf("%s\n", line.c_str());
+      for (const auto& [delta, name]: tops[i].Sorted())
+         PrintDelta(delta, name);
+   }
+}
+
+// Numeric options are never negative, and stoull would silently wrap "-1" around to the maximum
+void CheckNotNegative(const string& s)
+{
+   auto first = s.find_first_not_of(" \t");
+   if (first == string::npos || s[first] == '-')
+      throw invalid_argument(s);
+}
+
+// Parses a whole non-negative number no bigger than limit, throwing invalid_argument or out_of_range
+umax ParseCount(const string& s, umax limit=UINTMAX_MAX)
+{
+   CheckNotNegative(s);
+   size_t end = 0;
+   const umax value = stoull(s, &end);
+   if (end != s.size())
+      throw invalid_argument(s);
+   if (value > limit)
+      throw out_of_range(s);
+   return value;
+}
+
+// Parses a fraction between 0 and 1 such as an I/O budget
+double ParseFraction(const string& s)
+{
+   CheckNotNegative(s);
+   size_t end = 0;
+   const double value = stod(s, &end);
+   if (end != s.size())
+      throw invalid_argument(s);
+   if (!(value <= 1))
+      throw out_of_range(s);
+   return value;
+}
+
 int main(int argc, char *argv[])
 {
    console = GetStdHandle(STD_OUTPUT_HANDLE);
    bool walk = false;
+   bool largest = false;
+   bool sniff = false;
+   umax sniffmin = 64_KB;
+   bool compressibility = false;
+   double iobudget = 0.01;
+   size_t threads = 0;
+   path savefile;
+   path diffold, diffnew;
    size_t topcount = 500;
    vector<string> targets;
 
-   for (int i=1; i<argc; i++)
+   auto getarg = [&](int i)
    {
       printf("  [%d]: %s\n", i, argv[i]);
       auto len = strlen(argv[i]);
@@ -228,173 +1216,413 @@ int main(int argc, char *argv[])
       if (argv[i][len-1] == '\"')
          argv[i][len-1] = 0;
 
-      string arg = ToLower(argv[i]);
+      return ToLower(argv[i]);
+   };
 
-      if (arg == "-walk")
-         walk = true;
-      else
-         targets.push_back(arg);
+   for (int i=1; i<argc; i++)
+   {
+      string arg = getarg(i);
+
+      try
+      {
+         if (arg == "-walk")
+            walk = true;
+         else if (arg == "-largest")
+            largest = true;
+         else if (arg == "-top" && i+1 < argc)
+            topcount = (size_t)ParseCount(getarg(++i), SIZE_MAX);
+         else if (arg == "-sniff")
+            sniff = true;
+         else if (arg == "-sniffmin" && i+1 < argc)
+            sniffmin = ParseCount(getarg(++i));
+         else if (arg == "-compressibility")
+            compressibility = true;
+         else if (arg == "-iobudget" && i+1 < argc)
+            iobudget = ParseFraction(getarg(++i));
+         else if (arg == "-threads" && i+1 < argc)
+            threads = max<size_t>((size_t)ParseCount(getarg(++i), max_scan_workers), 1);
+         else if (arg == "-save" && i+1 < argc)
+            savefile = getarg(++i);
+         else if (arg == "-diff" && i+2 < argc)
+         {
+            diffold = getarg(++i);
+            diffnew = getarg(++i);
+         }
+         else
+            targets.push_back(arg);
+      }
+      catch (const logic_error&)
+      {
+         // The parsers throw invalid_argument or out_of_range, leave the default in place
+         SetColor(red);
+         printf("ERROR: bad value for %s: %s\n", arg.c_str(), argv[i]);
+         SetColor(silver);
+      }
+   }
+
+   if (!diffold.empty())
+   {
+      try
+      {
+         RunDiff(diffold, diffnew, topcount);
+      }
+      catch (const exception& e)
+      {
+         SetColor(red);
+         printf("ERROR: %s\n", e.what());
+      }
+      system("pause");
+      return 0;
    }
 
    if (targets.empty())
       targets.emplace_back(current_path().string());
 
+   // The walk prints a depth-first tree, so it can't be reordered by the scheduler
+   if (walk)
+      largest = false;
+
    FileStats stats;
-   vector<FileInfo> files;
+   TopFiles top {topcount};
    unordered_map<file_type, vector<FileInfo>> filesByType;
    unordered_map<wstring, vector<FileInfo>> filesByExt;
+   vector<FileInfo> sniffs;
 
    auto basey = GetPos().Y;
 
-   for (const path& root: targets)
+   auto add = [&](const FileInfo& info)
+   {
+      const auto ext = info.path.extension().wstring();
+      stats.Add(info.type, info.path, ext, info.size, info.ondisk);
+      top.Add(info);
+      filesByType[info.type].push_back(info);
+      filesByExt[ext].push_back(info);
+      if (sniff && info.size >= sniffmin)
+         sniffs.push_back(info);
+   };
+
+   umax errorcount = 0;
+
+   // Prints one line of the tree for -walk
+   auto visit = [&](const directory_entry& entry, int depth)
+   {
+      try
+      {
+         const auto path = entry.path();
+         const auto name = path.filename().wstring();
+         const file_type type = entry.status().type();
+         const auto bytes = entry.file_size();
+         const auto ondisk = size_on_disk(path.string().c_str());
+
+         if (!entry.is_directory())
+            add({type, path, bytes, ondisk});
+
+         static string indent(512, ' ');
+
+         indent.resize(tab_size * depth, ' ');
+         if (indent.size() >= tab_size)
+            indent[indent.size()-tab_size] = '|';
+
+         auto [bytesbuf, sizebuf] = GetSizeStr(bytes);
+         auto [pre, post, color] = infos.at(type);
+         SetColor(color);
+
+         int sizecolor;
+
+         if (entry.is_directory())
+         {
+            sizebuf = "";
+            bytesbuf = "<DIR>";
+            sizecolor = gray;
+         }
+         else
+         {
+            sizecolor = GetSizeColor(bytes);
+         }
+
+         SetColor(sizecolor);
+         printf("%12s %25s", sizebuf, bytesbuf);
+         printf("%s", tab.c_str());
+         SetColor(gray);
+         printf("%s", indent.c_str());
+         SetColor(color);
+         if constexpr (use_delims)
+            printf("%s%ls%s", pre, name.c_str(), post);
+         else
+            printf("%ls", name.c_str());
+         printf("\n");
+      }
+      catch (const exception& e)
+      {
+         errorcount++;
+         SetColor(red);
+         printf("ERROR: %s\n", e.what());
+      }
+   };
+
+   ConcurrencyController workers {min(WorkerCount(), max_scan_workers), max_scan_workers};
+   if (threads)
+      workers = {threads, threads, false};
+
+   if (walk)
    {
-      for (recursive_directory_iterator dir(root), end; dir!=end; ++dir)
+      for (const path& root: targets)
+         for (recursive_directory_iterator dir(root), end; dir!=end; ++dir)
+            visit(*dir, dir.depth());
+   }
+   else
+   {
+      // The snapshot about to be replaced knows how big every directory was last time
+      unordered_map<wstring, umax> priors;
+      if (largest && !savefile.empty() && exists(savefile))
       {
          try
          {
-            const auto& entry = *dir;
-            const auto depth = dir.depth();
-            const auto path = entry.path();
-            const auto name = path.filename().wstring();
-            const auto ext = path.extension().wstring();
-            const file_type type = entry.status().type();
-            const auto bytes = entry.file_size();
-            const auto ondisk = size_on_disk(path.string().c_str());
-
-            if (!entry.is_directory())
-            {
-               FileInfo info {type, path, bytes};
+            priors = LoadDirHints(savefile);
+         }
+         catch (const exception& e)
+         {
+            SetColor(red);
+            printf("ERROR: %s\n", e.what());
+         }
+      }
 
-               stats.Add(type, path, ext, bytes, ondisk);
-               files.push_back(info);
-               filesByType[type].push_back(info);
-               filesByExt[ext].push_back(info);
-            }
+      // Directories are handed out to a pool of workers.  queuelock guards the queue and the worker
+      // controller, statslock guards everything add() touches and the error tally.  Only the main thread
+      // touches the console, drawing the panel from a copy taken under statslock so redrawing doesn't
+      // hold up the workers.
+      priority_queue<DirTask> queue;
+      for (const path& root: targets)
+         queue.push({root, 0, largest ? unknown_hint : 0});
 
-            if (walk)
-            {
-               static string indent(512, ' ');
+      mutex queuelock, statslock;
+      condition_variable wake;
+      size_t busy = 0;
+      bool done = false;
+      path current;
+      string lasterror;
+      atomic<umax> scanned = 0;
+      atomic<umax> syscalls = 0;
+      atomic<umax> syscallns = 0;
 
-               indent.resize(tab_size * depth, ' ');
-               if (indent.size() >= tab_size)
-                  indent[indent.size()-tab_size] = '|';
+      auto worker = [&](size_t index)
+      {
+         using clock = chrono::steady_clock;
 
-               auto [bytesbuf, sizebuf] = GetSizeStr(bytes);
-               auto [pre, post, color] = infos.at(type);
-               SetColor(color);
+         for (;;)
+         {
+            DirTask task;
+            {
+               unique_lock lock(queuelock);
+               wake.wait(lock, [&]{ return done || (index < workers.active && !queue.empty()); });
+               if (done)
+                  return;
+               task = queue.top();
+               queue.pop();
+               busy++;
+            }
 
-               int sizecolor;
+            umax filebytes = 0;
+            umax entries = 0;
+            vector<FileInfo> found;
+            vector<path> subdirs;
+            vector<string> errors;
 
-               if (entry.is_directory())
-               {
-                  sizebuf = "";
-                  bytesbuf = "<DIR>";
-                  sizecolor = gray;
-               }
-               else
+            try
+            {
+               for (const auto& entry: directory_iterator(task.dir))
                {
-                  sizecolor = GetSizeColor(bytes);
+                  entries++;
+                  scanned++;
+                  try
+                  {
+                     error_code ec;
+                     if (entry.is_directory(ec))
+                     {
+                        // Like recursive_directory_iterator, don't follow symlinks or NTFS junctions
+                        if (entry.symlink_status(ec).type() == file_type::directory)
+                           subdirs.push_back(entry.path());
+                        continue;
+                     }
+
+                     const auto path = entry.path();
+                     const file_type type = entry.status().type();
+                     const auto bytes = entry.file_size();
+
+                     auto start = clock::now();
+                     const auto ondisk = size_on_disk(path.string().c_str());
+                     syscallns += chrono::duration_cast<chrono::nanoseconds>(clock::now() - start).count();
+                     syscalls++;
+
+                     found.push_back({type, path, bytes, ondisk});
+                     filebytes += bytes;
+                  }
+                  catch (const exception& e)
+                  {
+                     errors.push_back(e.what());
+                  }
                }
+            }
+            catch (const exception& e)
+            {
+               errors.push_back(e.what());
+            }
+
+            umax avgfile;
+            {
+               lock_guard lock(statslock);
+               for (const auto& f: found)
+                  add(f);
+               current = task.dir;
+               avgfile = stats.total.count ? stats.total.Avg() : 0;
 
-               SetColor(sizecolor);
-               printf("%12s %25s", sizebuf, bytesbuf);
-               printf("%s", tab.c_str());
-               SetColor(gray);
-               printf("%s", indent.c_str());
-               SetColor(color);
-               if constexpr (use_delims)
-                  printf("%s%ls%s", pre, name.c_str(), post);
-               else
-                  printf("%ls", name.c_str());
-               printf("\n");
+               errorcount += errors.size();
+               if (!errors.empty())
+                  lasterror = errors.back();
             }
-            else
+
+            const umax hint = largest ? ChildHint(task.hint, filebytes, entries, avgfile, subdirs.size()) : 0;
             {
-               auto y = basey;
-               SetColor(white);
-               Write({0, y++}, sformat("file: %s", path.string().c_str()));
-               Write({0, y++}, sformat("count: %s", str(stats.total.count)));
-               Write({0, y++}, sformat("logical size: %s (%s)", SizeStr(stats.total.size), BytesStr(stats.total.size)));
-               SetColor(cyan);
-               Write({0, y++}, sformat("size on disk: %s (%s)", SizeStr(stats.total.ondisk), BytesStr(stats.total.ondisk)));
+               lock_guard lock(queuelock);
+               for (auto& dir: subdirs)
+               {
+                  auto prior = priors.find(dir.wstring());
+                  queue.push({move(dir), task.depth + 1, prior != priors.end() ? prior->second : hint});
+               }
+               busy--;
+               done = queue.empty() && busy == 0;
             }
+            wake.notify_all();
          }
-         catch (const exception& e)
+      };
+
+      vector<thread> pool;
+      loopi(workers.limit)
+         pool.emplace_back(worker, (size_t)i);
+
+      // Every interval, feed the controller the entries/sec and size_on_disk latency since the last one,
+      // then redraw the live panel
+      using clock = chrono::steady_clock;
+      constexpr auto refresh_interval = 250ms;
+      auto last = clock::now();
+      umax lastscanned = 0, lastcalls = 0, lastns = 0;
+
+      for (;;)
+      {
          {
-            SetColor(red);
-            printf("ERROR: %s\n", e.what());
+            unique_lock lock(queuelock);
+            if (wake.wait_for(lock, refresh_interval, [&]{ return done; }))
+               break;
+         }
+
+         const auto now = clock::now();
+         const double seconds = chrono::duration<double>(now - last).count();
+         const umax calls = syscalls - lastcalls;
+         const double rate = (scanned - lastscanned) / seconds;
+         const double latency = calls ? (syscallns - lastns) / (double)calls / unit_milli : 0;
+         last = now;
+         lastscanned = scanned;
+         lastcalls = syscalls;
+         lastns = syscallns;
+
+         size_t active;
+         {
+            lock_guard lock(queuelock);
+            workers.Update(rate, latency);
+            active = workers.active;
          }
+         wake.notify_all();
+
+         const size_t listrows = LiveView::ListRows();
+         unique_lock lock(statslock);
+         const LiveView view(current, stats, top, listrows, errorcount, lasterror);
+         lock.unlock();
+
+         DrawLive(basey, view, listrows, sformat("workers: %s active, %.0f entries/s, %.1f us per size_on_disk",
+                                                 str(active), rate, latency));
       }
-   }
 
-   Clear();
-   SetColor(white);
+      for (auto& t: pool)
+         t.join();
+   }
 
-   struct SizePair
+   if (!savefile.empty())
    {
-      cstr header[2];
-      umax(*func)(const Stats&);
-   };
-
-   vector<pair<wstring, Stats>> exts(stats.byext.begin(), stats.byext.end());
-   sort(exts.begin(), exts.end(), [](const auto& a, const auto& b){ return a.second.size > b.second.size; });
+      try
+      {
+         SetColor(white);
+         Write({0, GetPos().Y}, sformat("saving snapshot to %s...", savefile.string().c_str()));
+         SaveSnapshot(savefile, filesByExt, targets);
+      }
+      catch (const exception& e)
+      {
+         SetColor(red);
+         printf("ERROR: %s\n", e.what());
+      }
+   }
 
-   static constexpr cstr prefmt = "  %-26ls %8s";
-   static constexpr cstr numfmt[] {" %18s", " %16s"};
+   unordered_map<wstring, Stats> bydetected;
+   if (sniff)
+   {
+      SetColor(white);
+      Write({0, GetPos().Y}, sformat("sniffing %s files...", str(sniffs.size())));
+      bydetected = SniffTypes(sniffs);
+   }
 
-   const SizePair pairs[]
+   umax sampled = 0;
+   if (compressibility)
    {
-      {{"bytes",         "size"},         [](const Stats& s){ return s.size; }},
-      {{"avg bytes",     "avg size"},     [](const Stats& s){ return s.Avg(); }},
-      {{"bytes on disk", "size on disk"}, [](const Stats& s){ return s.ondisk; }},
-   };
+      SetColor(white);
+      Write({0, GetPos().Y}, sformat("sampling compressibility, reading at most %s...", SizeStr((umax)(stats.total.size * iobudget))));
+      sampled = EstimateCompressibility(stats, filesByExt, iobudget);
+   }
 
-   string header;
-   header += sformat(prefmt, L"ext", "count");
-   for (const auto& s: pairs)
-      loopi(2)
-         header += sformat(numfmt[i], s.header[i]);
+   Clear();
+   if (!walk)
+      SetPos(0, basey);
+   SetColor(white);
 
+   const string header = TableHeader(L"ext", compressibility);
    const size_t linewidth = header.size();
    static const string line(linewidth, '-');
 
    printf("\n");
    SetColor(white);
+   if (!walk)
+      printf("Scanned with %s of %s workers active at the end\n", str(workers.active), str(workers.limit));
+   if (errorcount)
+   {
+      SetColor(red);
+      printf("%s entries couldn't be read\n", str(errorcount));
+      SetColor(white);
+   }
+   if (compressibility)
+      printf("Compressibility sampled from %s (%.2f%% of the data)\n", SizeStr(sampled), 100.0 * sampled / max<umax>(stats.total.size, 1));
    printf("%s\n", header.c_str());
    SetColor(gray);
    printf("%s\n", line.c_str());
    
-   for (const auto& e: exts)
+   for (const auto& [ext, s]: SortBySize(stats.byext))
+      PrintTableRow(ext, s, compressibility);
+
+   if (sniff)
    {
+      printf("\n\n");
       SetColor(white);
-      printf(prefmt, e.first.c_str(), str(e.second.count));
-      for (const auto& p: pairs)
-      {
-         auto sz = p.func(e.second);
-         auto [bytes, size] = GetSizeStr(sz);
-         SetColor(gray);
-         printf(numfmt[0], bytes);
-         SetColor(GetSizeColor(sz));
-         printf(numfmt[1], size);
-      }
-      printf("\n");
+      printf("Detected types of %s files of at least %s:\n", str(sniffs.size()), SizeStr(sniffmin));
+      printf("%s\n", TableHeader(L"detected type").c_str());
+      SetColor(gray);
+      printf("%s\n", line.c_str());
+      for (const auto& [type, s]: SortBySize(bydetected))
+         PrintTableRow(type, s);
    }
 
-   sort(files.begin(), files.end(), [](const auto& a, const auto& b){ return a.size > b.size; });
-   if (files.size() > topcount)
-      files.resize(topcount);
+   SetColor(white);
    printf("\n\n");
    printf("Top %s files:\n", str(topcount));
    printf("%s\n", line.c_str());
-   for (const auto& f: files)
-   {
-      SetColor(gray);
-      printf("  %16s", BytesStr(f.size));
-      SetColor(GetSizeColor(f.size));
-      printf(" %16s     ", SizeStr(f.size));
-      SetColor(white);
-      printf("%ls\n", f.path.wstring().c_str());
-   }
+   for (const auto& f: top.Sorted())
+      PrintTopFile(f);
 
    system("pause");
    return 0;
@@ -12,6 +12,12 @@
 #include <cstdarg>
 #include <filesystem>
 #include <algorithm>
+#include <queue>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
 #undef min